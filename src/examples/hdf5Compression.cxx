@@ -0,0 +1,92 @@
+#include <timmilicious/timmilicious.hxx>
+#include <timmilicious/io/HDF5.hxx>
+#include <boost/thread/thread.hpp>
+#include <boost/timer/timer.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+using namespace timmilicious::io;
+
+#define BENCHMARK_FILE_PATH "/tmp/timmitest_hdf5compression.h5"
+#define BENCHMARK_REPETITIONS 5
+
+/**
+ * Get the throughput in MB/s for writing the supplied matrix the given number of times.
+ */
+static double getThroughput( const cv::Mat & matrix, const boost::timer::cpu_timer & timer ) {
+	const double megabytes = static_cast< double >( matrix.total() * matrix.elemSize() * BENCHMARK_REPETITIONS ) / ( 1024.0 * 1024.0 );
+	return megabytes / ( static_cast< double >( timer.elapsed().wall ) / 1000000000.0 );
+}
+
+/**
+ * Write the matrix using the parallel compression with direct chunk writes.
+ */
+static double benchmarkParallel( const cv::Mat & matrix, const unsigned int numberOfThreads ) {
+	boost::timer::cpu_timer timer;
+	for( int i = 0; i < BENCHMARK_REPETITIONS; ++i ) {
+		HDF5 file( BENCHMARK_FILE_PATH, true );
+		file.addMatrixCompressed( matrix, "/", "benchmark", 6, numberOfThreads );
+	}
+	timer.stop();
+	return getThroughput( matrix, timer );
+}
+
+/**
+ * Write the matrix through the filter pipeline of the HDF5 library, using the same
+ * chunk layout and filter settings as the parallel implementation.
+ */
+static double benchmarkFilterPipeline( const cv::Mat & matrix ) {
+	// get the dataset creation properties from a dataset written by the library
+	{
+		HDF5 file( BENCHMARK_FILE_PATH, true );
+		file.addMatrixCompressed( matrix, "/", "benchmark", 6, 1 );
+	}
+	hid_t fileId = H5Fopen( BENCHMARK_FILE_PATH, H5F_ACC_RDONLY, H5P_DEFAULT );
+	hid_t dataset = H5Dopen( fileId, "/benchmark", H5P_DEFAULT );
+	hid_t creationProperties = H5Dget_create_plist( dataset );
+	hid_t dataspace = H5Dget_space( dataset );
+	H5Dclose( dataset );
+	H5Fclose( fileId );
+
+	//
+	boost::timer::cpu_timer timer;
+	for( int i = 0; i < BENCHMARK_REPETITIONS; ++i ) {
+		fileId = H5Fcreate( BENCHMARK_FILE_PATH, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT );
+		dataset = H5Dcreate2( fileId, "/benchmark", H5T_STD_U8LE, dataspace, H5P_DEFAULT, creationProperties, H5P_DEFAULT );
+		H5Dwrite( dataset, H5T_NATIVE_UCHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT, matrix.ptr() );
+		H5Dclose( dataset );
+		H5Fclose( fileId );
+	}
+	timer.stop();
+
+	H5Sclose( dataspace );
+	H5Pclose( creationProperties );
+	return getThroughput( matrix, timer );
+}
+
+int main( int, char ** ) {
+	std::cout << "HDF5 compression benchmark using libTimmilicious " << timmilicious::getAPIVersion()
+		  << " (" << timmilicious::getABIVersion() << ")" << std::endl << std::endl;
+
+	// create a matrix with some structure and a bit of noise, like a camera frame
+	cv::Mat frame( 4096, 4096, CV_8U, cv::Scalar( 0, 255 ) );
+	for( int y = 0; y < frame.rows; ++y ) {
+		for( int x = 0; x < frame.cols; ++x ) {
+			frame.ptr( y )[ x ] = static_cast< unsigned char >( ( ( x + y ) / 16 + rand() % 8 ) % 256 );
+		}
+	}
+
+	//
+	std::cout << std::fixed << std::setprecision( 1 );
+	std::cout << "H5Dwrite (filter pipeline):  " << std::setw( 8 ) << benchmarkFilterPipeline( frame ) << " MB/s" << std::endl;
+
+	//
+	const unsigned int maxThreads = std::max( 1u, boost::thread::hardware_concurrency() );
+	for( unsigned int threads = 1; threads < maxThreads * 2; threads *= 2 ) {
+		const unsigned int usedThreads = std::min( threads, maxThreads );
+		std::cout << "H5Dwrite_chunk (" << std::setw( 3 ) << usedThreads << " threads): " << std::setw( 8 ) << benchmarkParallel( frame, usedThreads ) << " MB/s" << std::endl;
+	}
+
+	return 0;
+}
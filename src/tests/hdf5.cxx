@@ -17,10 +17,36 @@
  */
 #include <gtest/gtest.h>
 #include <timmilicious/io/HDF5.hxx>
+#include <cstring>
+#include <vector>
 using namespace timmilicious::io;
 
 #define HDF5_TEST_FILE_PATH "/tmp/hdf5test.h5"
 
+/**
+ * Read the raw data of a dataset inside of the test file with the plain HDF5 library.
+ */
+static std::vector< unsigned char > readDataset( const char *name, const cv::Mat & matrix ) {
+	std::vector< unsigned char > buffer( matrix.total() * matrix.elemSize() );
+
+	hid_t fileId = H5Fopen( HDF5_TEST_FILE_PATH, H5F_ACC_RDONLY, H5P_DEFAULT );
+	hid_t dataset = H5Dopen( fileId, name, H5P_DEFAULT );
+	if( dataset < 0 || H5Dread( dataset, H5T_NATIVE_UCHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT, buffer.data() ) < 0 ) {
+		buffer.clear();
+	}
+	H5Dclose( dataset );
+	H5Fclose( fileId );
+
+	return buffer;
+}
+
+/**
+ * Check if the supplied data is the same as the data of the matrix.
+ */
+static bool isMatrixData( const std::vector< unsigned char > & data, const cv::Mat & matrix ) {
+	return data.size() == matrix.total() * matrix.elemSize() && memcmp( data.data(), matrix.ptr(), data.size() ) == 0;
+}
+
 TEST( HDF5, Constructor ) {
 	ASSERT_THROW( HDF5( "" ), std::invalid_argument );
 	ASSERT_THROW( HDF5( "", true ), std::invalid_argument );
@@ -30,6 +56,25 @@ TEST( HDF5, Constructor ) {
 	ASSERT_NO_THROW( HDF5( HDF5_TEST_FILE_PATH, true ) );
 }
 
+TEST( HDF5, ConstructorLatestFileFormat ) {
+	cv::Mat M( 64, 64, CV_8U, cv::Scalar( 3, 255 ) );
+
+	// create a container which uses the latest file format of the HDF5 library
+	hid_t accessProperties = H5Pcreate( H5P_FILE_ACCESS );
+	H5Pset_libver_bounds( accessProperties, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST );
+	hid_t fileId = H5Fcreate( HDF5_TEST_FILE_PATH, H5F_ACC_TRUNC, H5P_DEFAULT, accessProperties );
+	H5Pclose( accessProperties );
+	ASSERT_LE( 0, fileId );
+	H5Fclose( fileId );
+
+	// such containers have to be usable as well
+	{
+		HDF5 file( HDF5_TEST_FILE_PATH );
+		ASSERT_NO_THROW( file.addMatrix( M, "/", "testMat00" ) );
+	}
+	ASSERT_TRUE( isMatrixData( readDataset( "/testMat00", M ), M ) );
+}
+
 TEST( HDF5, createGroup ) {
 	HDF5 file( HDF5_TEST_FILE_PATH, true );
 
@@ -72,3 +117,236 @@ TEST( HDF5, addMatrix ) {
 	ASSERT_NO_THROW( file.addMatrix( M2, "/short/path", "testMat04" ) );
 	ASSERT_NO_THROW( file.addMatrix( M2, "/this/is/a/longer/test/path/inside/of/the/hdf5/file", "testMat05" ) );
 }
+
+TEST( HDF5, addMatrixDeduplication ) {
+	cv::Mat M( 1024, 1024, CV_8U, cv::Scalar( 0, 255 ) );
+	cv::Mat M2( 1024, 1024, CV_8U, cv::Scalar( 42, 255 ) );
+
+	//
+	{
+		HDF5 file( HDF5_TEST_FILE_PATH, true );
+
+		ASSERT_EQ( false, file.isDeduplicationEnabled() );
+		file.setDeduplication( true );
+		ASSERT_EQ( true, file.isDeduplicationEnabled() );
+
+		//
+		ASSERT_NO_THROW( file.addMatrix( M, "/", "testMat00" ) );
+		ASSERT_NO_THROW( file.addMatrix( M, "/short/path", "testMat01" ) );
+		ASSERT_NO_THROW( file.addMatrix( M2, "/short/path", "testMat02" ) );
+		ASSERT_NO_THROW( file.addMatrix( M, "/this/is/a/longer/test/path/inside/of/the/hdf5/file", "testMat03" ) );
+
+		// just the first and the third matrix should be written, the other ones are links
+		const HDF5::DeduplicationStatistics & statistics = file.getDeduplicationStatistics();
+		ASSERT_EQ( 2u, statistics.matricesWritten );
+		ASSERT_EQ( 2u, statistics.matricesLinked );
+		ASSERT_EQ( 4u * 1024u * 1024u, statistics.bytesHashed );
+		ASSERT_EQ( 2u * 1024u * 1024u, statistics.bytesWritten );
+		ASSERT_EQ( 2u * 1024u * 1024u, statistics.bytesSaved );
+		ASSERT_EQ( 2u * 1024u * 1024u, statistics.bytesVerified );
+		ASSERT_LE( 0.0, statistics.getHashingOverheadPerMegabyte() );
+		ASSERT_LE( 0.0, statistics.getVerificationOverheadPerMegabyte() );
+
+		// the linked matrices have to look like the written ones
+		ASSERT_EQ( true, file.groupExists( "/short/path/testMat01" ) );
+		ASSERT_EQ( 1u, file.getAttributes( "/short/path/testMat01" ).count( "MatrixType" ) );
+		ASSERT_EQ( 1u, file.getAttributes( "/this/is/a/longer/test/path/inside/of/the/hdf5/file/testMat03" ).count( "MatrixType" ) );
+	}
+
+	// the index must not show up as additional entries inside of the container
+	H5G_info_t rootInfo;
+	hid_t fileId = H5Fopen( HDF5_TEST_FILE_PATH, H5F_ACC_RDONLY, H5P_DEFAULT );
+	ASSERT_LE( 0, H5Gget_info( fileId, &rootInfo ) );
+	H5Fclose( fileId );
+	ASSERT_EQ( 3u, rootInfo.nlinks );
+
+	// the linked matrices have to contain the same data as the written ones
+	ASSERT_TRUE( isMatrixData( readDataset( "/testMat00", M ), M ) );
+	ASSERT_TRUE( isMatrixData( readDataset( "/short/path/testMat01", M ), M ) );
+	ASSERT_TRUE( isMatrixData( readDataset( "/short/path/testMat02", M2 ), M2 ) );
+	ASSERT_TRUE( isMatrixData( readDataset( "/this/is/a/longer/test/path/inside/of/the/hdf5/file/testMat03", M ), M ) );
+
+	// the index has to be stored inside of the container and be used after reopening it
+	{
+		HDF5 file( HDF5_TEST_FILE_PATH, false );
+		file.setDeduplication( true );
+		ASSERT_NO_THROW( file.addMatrix( M2, "/", "testMat04" ) );
+		ASSERT_EQ( 0u, file.getDeduplicationStatistics().matricesWritten );
+		ASSERT_EQ( 1u, file.getDeduplicationStatistics().matricesLinked );
+	}
+	ASSERT_TRUE( isMatrixData( readDataset( "/testMat04", M2 ), M2 ) );
+}
+
+TEST( HDF5, addMatrixCompressed ) {
+	cv::Mat M( 1000, 1500, CV_8U, cv::Scalar( 0, 255 ) );
+	cv::Mat M2( 700, 500, CV_8UC3, cv::Scalar( 0, 255 ) );
+
+	// fill the matrices with some compressible data which does not fit into a single chunk
+	for( int y = 0; y < M.rows; ++y ) {
+		for( int x = 0; x < M.cols; ++x ) {
+			M.ptr( y )[ x ] = static_cast< unsigned char >( ( x / 8 + y ) % 256 );
+		}
+	}
+	for( int y = 0; y < M2.rows; ++y ) {
+		for( int x = 0; x < M2.cols * 3; ++x ) {
+			M2.ptr( y )[ x ] = static_cast< unsigned char >( ( x * y ) % 251 );
+		}
+	}
+
+	//
+	{
+		HDF5 file( HDF5_TEST_FILE_PATH, true );
+		ASSERT_NO_THROW( file.addMatrixCompressed( M, "/", "testMat00" ) );
+		ASSERT_NO_THROW( file.addMatrixCompressed( M, "/short/path", "testMat01", 9, 1 ) );
+		ASSERT_NO_THROW( file.addMatrixCompressed( M2, "/short/path", "testMat02", 1, 3 ) );
+		ASSERT_EQ( 1u, file.getAttributes( "/short/path/testMat02" ).count( "MatrixType" ) );
+	}
+
+	// the datasets have to be readable by the plain HDF5 library
+	hid_t fileId = H5Fopen( HDF5_TEST_FILE_PATH, H5F_ACC_RDONLY, H5P_DEFAULT );
+	ASSERT_LE( 0, fileId );
+	const char *names[] = { "/testMat00", "/short/path/testMat01", "/short/path/testMat02" };
+	const cv::Mat *matrices[] = { &M, &M, &M2 };
+	for( unsigned int i = 0; i < 3; ++i ) {
+		const size_t numberOfBytes = matrices[ i ]->total() * matrices[ i ]->elemSize();
+		std::vector< unsigned char > buffer( numberOfBytes );
+
+		hid_t dataset = H5Dopen( fileId, names[ i ], H5P_DEFAULT );
+		ASSERT_LE( 0, dataset );
+		hid_t creationProperties = H5Dget_create_plist( dataset );
+		ASSERT_EQ( 1, H5Pget_nfilters( creationProperties ) );
+		H5Pclose( creationProperties );
+		ASSERT_LE( 0, H5Dread( dataset, H5T_NATIVE_UCHAR, H5S_ALL, H5S_ALL, H5P_DEFAULT, buffer.data() ) );
+		ASSERT_GT( numberOfBytes, static_cast< size_t >( H5Dget_storage_size( dataset ) ) );
+		H5Dclose( dataset );
+		ASSERT_EQ( 0, memcmp( buffer.data(), matrices[ i ]->ptr(), numberOfBytes ) );
+	}
+	H5Fclose( fileId );
+}
+
+/**
+ * Let all entries of the deduplication index inside of the test file point to the supplied dataset.
+ */
+static herr_t redirectIndexEntry( hid_t location, const char *attributeName, const H5A_info_t *, void *target ) {
+	if( strncmp( attributeName, "__timmilicious_dedup_", 21 ) == 0 ) {
+		hobj_ref_t reference;
+		H5Rcreate( &reference, location, static_cast< const char * >( target ), H5R_OBJECT, -1 );
+		hid_t attribute = H5Aopen( location, attributeName, H5P_DEFAULT );
+		H5Awrite( attribute, H5T_STD_REF_OBJ, &reference );
+		H5Aclose( attribute );
+	}
+	return 0;
+}
+
+TEST( HDF5, addMatrixDeduplicationChangedIndex ) {
+	cv::Mat M( 64, 64, CV_8U, cv::Scalar( 5, 255 ) );
+	cv::Mat N( 512, 512, CV_8U, cv::Scalar( 5, 255 ) );
+
+	//
+	{
+		HDF5 file( HDF5_TEST_FILE_PATH, true );
+		file.setDeduplication( true );
+		ASSERT_NO_THROW( file.addMatrix( M, "/", "small" ) );
+		file.setDeduplication( false );
+		ASSERT_NO_THROW( file.addMatrix( N, "/", "large" ) );
+		ASSERT_NO_THROW( file.createGroup( "/group" ) );
+	}
+
+	// an index entry which points to an object with another shape or type must not be used
+	const char *targets[] = { "/large", "/group" };
+	const char *copies[] = { "/largeCopy", "/groupCopy" };
+	for( unsigned int i = 0; i < 2; ++i ) {
+		hid_t fileId = H5Fopen( HDF5_TEST_FILE_PATH, H5F_ACC_RDWR, H5P_DEFAULT );
+		ASSERT_LE( 0, fileId );
+		ASSERT_LE( 0, H5Aiterate2( fileId, H5_INDEX_NAME, H5_ITER_NATIVE, NULL, redirectIndexEntry, const_cast< char * >( targets[ i ] ) ) );
+		H5Fclose( fileId );
+
+		//
+		{
+			HDF5 file( HDF5_TEST_FILE_PATH );
+			file.setDeduplication( true );
+			ASSERT_NO_THROW( file.addMatrix( M, "/", copies[ i ] + 1 ) );
+			ASSERT_EQ( 1u, file.getDeduplicationStatistics().matricesWritten );
+			ASSERT_EQ( 0u, file.getDeduplicationStatistics().matricesLinked );
+		}
+		ASSERT_TRUE( isMatrixData( readDataset( copies[ i ], M ), M ) );
+	}
+}
+
+TEST( HDF5, addMatrixCompressedDeduplication ) {
+	cv::Mat M( 512, 512, CV_8U, cv::Scalar( 7, 255 ) );
+
+	//
+	{
+		HDF5 file( HDF5_TEST_FILE_PATH, true );
+		file.setDeduplication( true );
+
+		// the same data stored with a different compression must not be linked
+		ASSERT_NO_THROW( file.addMatrix( M, "/", "testMat00" ) );
+		ASSERT_NO_THROW( file.addMatrixCompressed( M, "/", "testMat01", 6 ) );
+		ASSERT_NO_THROW( file.addMatrixCompressed( M, "/", "testMat02", 1 ) );
+		ASSERT_EQ( 3u, file.getDeduplicationStatistics().matricesWritten );
+		ASSERT_EQ( 0u, file.getDeduplicationStatistics().matricesLinked );
+
+		// the same data stored with the same compression has to be linked
+		ASSERT_NO_THROW( file.addMatrixCompressed( M, "/", "testMat03", 6 ) );
+		ASSERT_NO_THROW( file.addMatrix( M, "/", "testMat04" ) );
+		ASSERT_EQ( 3u, file.getDeduplicationStatistics().matricesWritten );
+		ASSERT_EQ( 2u, file.getDeduplicationStatistics().matricesLinked );
+	}
+
+	// the compressed matrices have to stay compressed
+	hid_t fileId = H5Fopen( HDF5_TEST_FILE_PATH, H5F_ACC_RDONLY, H5P_DEFAULT );
+	ASSERT_LE( 0, fileId );
+	const char *names[] = { "/testMat00", "/testMat01", "/testMat03", "/testMat04" };
+	const int numberOfFilters[] = { 0, 1, 1, 0 };
+	for( unsigned int i = 0; i < 4; ++i ) {
+		hid_t dataset = H5Dopen( fileId, names[ i ], H5P_DEFAULT );
+		ASSERT_LE( 0, dataset );
+		hid_t creationProperties = H5Dget_create_plist( dataset );
+		ASSERT_EQ( numberOfFilters[ i ], H5Pget_nfilters( creationProperties ) );
+		H5Pclose( creationProperties );
+		H5Dclose( dataset );
+	}
+	H5Fclose( fileId );
+	ASSERT_TRUE( isMatrixData( readDataset( "/testMat03", M ), M ) );
+}
+
+TEST( HDF5, addMatrixUnsupportedType ) {
+	cv::Mat M( 512, 512, CV_16U, cv::Scalar( 0, 255 ) );
+
+	// matrices with an unsupported type must not be stored at all
+	HDF5 file( HDF5_TEST_FILE_PATH, true );
+	ASSERT_NO_THROW( file.addMatrix( M, "/", "testMat00" ) );
+	ASSERT_NO_THROW( file.addMatrixCompressed( M, "/", "testMat01" ) );
+	ASSERT_EQ( false, file.groupExists( "/testMat00" ) );
+	ASSERT_EQ( false, file.groupExists( "/testMat01" ) );
+}
+
+TEST( HDF5, addMatrixDeduplicationExistingName ) {
+	cv::Mat M( 256, 256, CV_8U, cv::Scalar( 1, 255 ) );
+	cv::Mat N( 256, 256, CV_8U, cv::Scalar( 2, 255 ) );
+
+	//
+	{
+		HDF5 file( HDF5_TEST_FILE_PATH, true );
+		file.setDeduplication( true );
+
+		// storing a matrix under an already used name must not touch the deduplication index
+		ASSERT_NO_THROW( file.addMatrix( M, "/", "a" ) );
+		ASSERT_NO_THROW( file.addMatrix( N, "/", "a" ) );
+		ASSERT_EQ( 1u, file.getDeduplicationStatistics().matricesWritten );
+		ASSERT_EQ( 0u, file.getDeduplicationStatistics().matricesLinked );
+
+		// the content of the rejected matrix has to be deduplicated correctly afterwards
+		ASSERT_NO_THROW( file.addMatrix( N, "/", "c" ) );
+		ASSERT_NO_THROW( file.addMatrix( N, "/", "d" ) );
+		ASSERT_EQ( 2u, file.getDeduplicationStatistics().matricesWritten );
+		ASSERT_EQ( 1u, file.getDeduplicationStatistics().matricesLinked );
+	}
+
+	//
+	ASSERT_TRUE( isMatrixData( readDataset( "/a", M ), M ) );
+	ASSERT_TRUE( isMatrixData( readDataset( "/c", N ), N ) );
+	ASSERT_TRUE( isMatrixData( readDataset( "/d", N ), N ) );
+}
@@ -22,19 +22,301 @@ using namespace timmilicious::io;
 // #include <awesomeIO/iReader.h>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <cstring> // memcpy, memcmp, memset
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <zlib.h>
+
+namespace {
+
+	// the prefix of the root group attributes which hold the entries of the deduplication index
+	const char *const DEDUPLICATION_INDEX_PREFIX = "__timmilicious_dedup_";
+
+	// the prime numbers used by the content hash (the same as used by xxHash64)
+	const uint64_t HASH_PRIME_1 = 11400714785074694791ULL;
+	const uint64_t HASH_PRIME_2 = 14029467366897019727ULL;
+	const uint64_t HASH_PRIME_3 = 1609587929392839161ULL;
+	const uint64_t HASH_PRIME_4 = 9650029242287828579ULL;
+	const uint64_t HASH_PRIME_5 = 2870177450012600261ULL;
+
+	inline uint64_t rotateLeft( const uint64_t value, const unsigned int bits ) noexcept {
+		return ( value << bits ) | ( value >> ( 64 - bits ) );
+	}
+
+	inline uint64_t readWord( const unsigned char *data ) noexcept {
+		uint64_t word;
+		memcpy( &word, data, sizeof( word ) );
+		return word;
+	}
+
+	inline uint64_t hashRound( uint64_t accumulator, const uint64_t input ) noexcept {
+		accumulator += input * HASH_PRIME_2;
+		accumulator = rotateLeft( accumulator, 31 );
+		return accumulator * HASH_PRIME_1;
+	}
+
+	inline uint64_t hashMerge( uint64_t accumulator, const uint64_t lane ) noexcept {
+		accumulator ^= hashRound( 0, lane );
+		return accumulator * HASH_PRIME_1 + HASH_PRIME_4;
+	}
+
+	/**
+	 * Calculate a 64 bit hash (xxHash64) of the supplied data. The main loop works on four
+	 * independent lanes, which allows the compiler to keep them in parallel registers.
+	 */
+	uint64_t contentHash( const unsigned char *data, const size_t length, const uint64_t seed ) noexcept {
+		const unsigned char *const end = data + length;
+		uint64_t hash;
+
+		if( length >= 32 ) {
+			uint64_t lanes[ 4 ] = { seed + HASH_PRIME_1 + HASH_PRIME_2, seed + HASH_PRIME_2, seed, seed - HASH_PRIME_1 };
+			const unsigned char *const limit = end - 32;
+
+			// process the data in stripes of 32 bytes
+			do {
+				for( unsigned int i = 0; i < 4; ++i ) {
+					lanes[ i ] = hashRound( lanes[ i ], readWord( data + i * 8 ) );
+				}
+				data += 32;
+			} while( data <= limit );
+
+			// merge the lanes into a single hash value
+			hash = rotateLeft( lanes[ 0 ], 1 ) + rotateLeft( lanes[ 1 ], 7 ) + rotateLeft( lanes[ 2 ], 12 ) + rotateLeft( lanes[ 3 ], 18 );
+			for( unsigned int i = 0; i < 4; ++i ) {
+				hash = hashMerge( hash, lanes[ i ] );
+			}
+		} else {
+			hash = seed + HASH_PRIME_5;
+		}
+		hash += static_cast< uint64_t >( length );
+
+		// process the remaining bytes
+		for( ; data + 8 <= end; data += 8 ) {
+			hash ^= hashRound( 0, readWord( data ) );
+			hash = rotateLeft( hash, 27 ) * HASH_PRIME_1 + HASH_PRIME_4;
+		}
+		if( data + 4 <= end ) {
+			uint32_t halfWord;
+			memcpy( &halfWord, data, sizeof( halfWord ) );
+			hash ^= static_cast< uint64_t >( halfWord ) * HASH_PRIME_1;
+			hash = rotateLeft( hash, 23 ) * HASH_PRIME_2 + HASH_PRIME_3;
+			data += 4;
+		}
+		for( ; data < end; ++data ) {
+			hash ^= static_cast< uint64_t >( *data ) * HASH_PRIME_5;
+			hash = rotateLeft( hash, 11 ) * HASH_PRIME_1;
+		}
+
+		// final avalanche
+		hash ^= hash >> 33;
+		hash *= HASH_PRIME_2;
+		hash ^= hash >> 29;
+		hash *= HASH_PRIME_3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+	// the (uncompressed) size of a single chunk used for compressed datasets
+	const size_t COMPRESSION_CHUNK_SIZE = 1024 * 1024;
+
+	/**
+	 * A chunk which was already passed through the deflate filter.
+	 */
+	struct CompressedChunk {
+		std::vector< unsigned char > data; // << The data which should be written to the file.
+		uint32_t filterMask = 0; // << The mask of filters which were skipped for this chunk.
+		bool ready = false; // << True if the chunk was compressed and can be written.
+	};
+
+	/**
+	 * Create a deflate compressed dataset and write the supplied data to it. The data is
+	 * split into chunks of full rows which are compressed by multiple threads. The calling
+	 * thread writes them in order as soon as they are ready, without passing them through
+	 * the filter pipeline of the HDF5 library.
+	 */
+	hid_t createCompressedDataset( const hid_t groupId, const std::string & name, const unsigned char *data, const size_t totalBytes, const hid_t nativeType, const hid_t dataspace, const hsize_t *dims, const int compressionLevel, unsigned int numberOfThreads ) noexcept {
+		const size_t rowBytes = static_cast< size_t >( dims[ 1 ] ) * H5Tget_size( nativeType );
+
+		// the dataset has to describe exactly the data of the matrix
+		if( unlikely( static_cast< size_t >( dims[ 0 ] ) * rowBytes != totalBytes ) ) {
+			std::cerr << "ERROR: The size of the dataset " << name << " does not match the size of the matrix" << std::endl; // TODO: better error handling
+			return -1;
+		}
+
+		// empty matrices can neither be chunked nor compressed
+		if( unlikely( totalBytes == 0 ) ) {
+			return H5Dcreate2( groupId, name.c_str(), nativeType, dataspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+		}
+
+		// each chunk contains as many full rows as fit into the chunk size
+		hsize_t chunkDims[ 2 ];
+		chunkDims[ 0 ] = std::max< hsize_t >( 1, std::min< hsize_t >( dims[ 0 ], COMPRESSION_CHUNK_SIZE / rowBytes ) );
+		chunkDims[ 1 ] = dims[ 1 ];
+		const size_t chunkBytes = static_cast< size_t >( chunkDims[ 0 ] ) * rowBytes;
+		const size_t numberOfChunks = ( totalBytes + chunkBytes - 1 ) / chunkBytes;
+
+		// create a standard deflate filtered dataset, so any reader can open it
+		hid_t creationProperties = H5Pcreate( H5P_DATASET_CREATE );
+		H5Pset_chunk( creationProperties, 2, chunkDims );
+		H5Pset_deflate( creationProperties, static_cast< unsigned int >( compressionLevel ) );
+		hid_t dataset = H5Dcreate2( groupId, name.c_str(), nativeType, dataspace, H5P_DEFAULT, creationProperties, H5P_DEFAULT );
+		H5Pclose( creationProperties );
+		if( dataset < 0 ) {
+			return dataset;
+		}
+
+		// just a limited number of compressed chunks may wait for being written
+		if( numberOfThreads == 0 ) {
+			numberOfThreads = std::max( 1u, boost::thread::hardware_concurrency() );
+		}
+		numberOfThreads = static_cast< unsigned int >( std::min< size_t >( numberOfThreads, numberOfChunks ) );
+		const size_t windowSize = 2 * static_cast< size_t >( numberOfThreads );
+		std::vector< CompressedChunk > chunks( numberOfChunks );
+		boost::mutex chunksMutex;
+		boost::condition_variable chunksChanged;
+		size_t nextChunkToCompress = 0;
+		size_t nextChunkToWrite = 0;
+
+		// compress the chunks in parallel
+		auto compressChunks = [ & ]() {
+			std::vector< unsigned char > paddedChunk;
+			std::vector< unsigned char > compressedChunk( compressBound( static_cast< uLong >( chunkBytes ) ) );
+			for( ;; ) {
+				size_t i;
+				{
+					boost::unique_lock< boost::mutex > lock( chunksMutex );
+					while( nextChunkToCompress < numberOfChunks && nextChunkToCompress >= nextChunkToWrite + windowSize ) {
+						chunksChanged.wait( lock );
+					}
+					if( nextChunkToCompress >= numberOfChunks ) {
+						return;
+					}
+					i = nextChunkToCompress++;
+				}
+				const size_t offset = i * chunkBytes;
+				const unsigned char *source = data + offset;
+
+				// the last chunk has to be padded to the full chunk size
+				if( offset + chunkBytes > totalBytes ) {
+					paddedChunk.assign( chunkBytes, 0 );
+					memcpy( paddedChunk.data(), source, totalBytes - offset );
+					source = paddedChunk.data();
+				}
+
+				// chunks which cannot be compressed are stored without applying the filter
+				std::vector< unsigned char > chunkData;
+				uint32_t filterMask = 0;
+				uLongf compressedSize = static_cast< uLongf >( compressedChunk.size() );
+				if( compress2( compressedChunk.data(), &compressedSize, source, static_cast< uLong >( chunkBytes ), compressionLevel ) == Z_OK && compressedSize < chunkBytes ) {
+					chunkData.assign( compressedChunk.begin(), compressedChunk.begin() + static_cast< std::ptrdiff_t >( compressedSize ) );
+				} else {
+					chunkData.assign( source, source + chunkBytes );
+					filterMask = 1;
+				}
+
+				// hand the chunk over to the writing thread
+				{
+					boost::lock_guard< boost::mutex > lock( chunksMutex );
+					chunks[ i ].data.swap( chunkData );
+					chunks[ i ].filterMask = filterMask;
+					chunks[ i ].ready = true;
+				}
+				chunksChanged.notify_all();
+			}
+		};
+		boost::thread_group workers;
+		for( unsigned int i = 0; i < numberOfThreads; ++i ) {
+			workers.create_thread( compressChunks );
+		}
+
+		// the HDF5 library is not thread-safe, so the chunks are written in order by this thread
+		bool writeFailed = false;
+		for( size_t i = 0; i < numberOfChunks && !writeFailed; ++i ) {
+			std::vector< unsigned char > chunkData;
+			uint32_t filterMask;
+			{
+				boost::unique_lock< boost::mutex > lock( chunksMutex );
+				while( !chunks[ i ].ready ) {
+					chunksChanged.wait( lock );
+				}
+				chunkData.swap( chunks[ i ].data );
+				filterMask = chunks[ i ].filterMask;
+			}
+
+			//
+			hsize_t offset[ 2 ] = { static_cast< hsize_t >( i ) * chunkDims[ 0 ], 0 };
+			if( H5Dwrite_chunk( dataset, H5P_DEFAULT, filterMask, offset, chunkData.size(), chunkData.data() ) < 0 ) {
+				std::cerr << "ERROR: Could not write chunk " << i << " of " << name << std::endl; // TODO: better error handling
+				writeFailed = true;
+			}
+
+			// let the threads continue with the next chunks (or stop them, if the writing failed)
+			{
+				boost::lock_guard< boost::mutex > lock( chunksMutex );
+				nextChunkToWrite = i + 1;
+				if( writeFailed ) {
+					nextChunkToCompress = numberOfChunks;
+				}
+			}
+			chunksChanged.notify_all();
+		}
+		workers.join_all();
+
+		// do not leave an incomplete dataset inside of the container
+		if( writeFailed ) {
+			H5Dclose( dataset );
+			H5Ldelete( groupId, name.c_str(), H5P_DEFAULT );
+			return -1;
+		}
+
+		return dataset;
+	}
+
+} /* anonymous namespace */
+
+double HDF5::DeduplicationStatistics::getHashingOverheadPerMegabyte() const noexcept {
+	if( this->bytesHashed == 0 ) {
+		return 0.0;
+	}
+	const double megabytes = static_cast< double >( this->bytesHashed ) / ( 1024.0 * 1024.0 );
+	return ( static_cast< double >( this->hashingTime ) / 1000000.0 ) / megabytes;
+}
+
+double HDF5::DeduplicationStatistics::getVerificationOverheadPerMegabyte() const noexcept {
+	if( this->bytesVerified == 0 ) {
+		return 0.0;
+	}
+	const double megabytes = static_cast< double >( this->bytesVerified ) / ( 1024.0 * 1024.0 );
+	return ( static_cast< double >( this->verificationTime ) / 1000000.0 ) / megabytes;
+}
 
 HDF5::HDF5( const std::string & file, const bool & overwrite ) noexcept( false ) {
+	this->mDeduplicationEnabled = false;
+	memset( &this->mDeduplicationStatistics, 0, sizeof( this->mDeduplicationStatistics ) );
+
 	// check if a valid path was supplied or not
 	if( file.length() <= 0 ) {
 		throw std::invalid_argument( "You have to supply a correct file path." );
 	}
 
+	// use at least the file format of HDF5 1.8, which indexes large numbers of attributes (as
+	// used by the deduplication index) instead of searching them linearly; newer formats are
+	// still allowed, so containers created with them can be opened as well
+	hid_t accessProperties = H5Pcreate( H5P_FILE_ACCESS );
+	H5Pset_libver_bounds( accessProperties, H5F_LIBVER_V18, H5F_LIBVER_LATEST );
+
 	// if we should overwrite the file, do so
 	if( overwrite ) {
-		this->mFileId = H5Fcreate( file.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT );
+		this->mFileId = H5Fcreate( file.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, accessProperties );
 		H5Fclose( this->mFileId );
 	}
-	this->mFileId = H5Fopen( file.c_str(), H5F_ACC_CREAT | H5F_ACC_RDWR, H5P_DEFAULT );
+	this->mFileId = H5Fopen( file.c_str(), H5F_ACC_CREAT | H5F_ACC_RDWR, accessProperties );
+	H5Pclose( accessProperties );
 
 	// check if the file was opened correctly
 	if( this->mFileId < 0 ) {
@@ -134,20 +416,144 @@ std::map< std::string, boost::any > HDF5::getAttributes( const std::string & fil
 	return returnVector;
 }
 
+void HDF5::setDeduplication( const bool & enable ) noexcept {
+	this->mDeduplicationEnabled = enable;
+}
+
+bool HDF5::isDeduplicationEnabled() const noexcept {
+	return this->mDeduplicationEnabled;
+}
+
+const HDF5::DeduplicationStatistics & HDF5::getDeduplicationStatistics() const noexcept {
+	return this->mDeduplicationStatistics;
+}
+
+std::string HDF5::getDeduplicationKey( const cv::Mat & matrix, const int & compressionLevel ) noexcept {
+	const size_t numberOfBytes = matrix.total() * matrix.elemSize();
+	std::ostringstream key;
+
+	// hash the data of the matrix, seeded with its type and shape
+	boost::timer::cpu_timer hashTimer;
+	const uint64_t seed = ( static_cast< uint64_t >( static_cast< uint32_t >( matrix.type() ) ) << 32 ) ^ ( static_cast< uint64_t >( static_cast< uint32_t >( matrix.rows ) ) << 16 ) ^ static_cast< uint64_t >( static_cast< uint32_t >( matrix.cols ) );
+	const uint64_t hash = contentHash( matrix.ptr(), numberOfBytes, seed );
+	hashTimer.stop();
+
+	// update the statistics
+	this->mDeduplicationStatistics.bytesHashed += numberOfBytes;
+	this->mDeduplicationStatistics.hashingTime += hashTimer.elapsed().wall;
+
+	// the type and shape are part of the key, so just the data can cause a collision; the
+	// compression level is part of it as well, so no matrix is linked to differently stored data
+	key << std::hex << std::setw( 16 ) << std::setfill( '0' ) << hash << std::dec << "_" << matrix.type() << "_" << matrix.rows << "x" << matrix.cols << "_z" << compressionLevel;
+	return key.str();
+}
+
+hid_t HDF5::findDuplicate( const cv::Mat & matrix, const hid_t & nativeType, const hsize_t *dims, const std::string & key ) noexcept {
+	const std::string attributeName = DEDUPLICATION_INDEX_PREFIX + key;
+	hobj_ref_t reference;
+
+	// check if the index contains the key
+	if( H5Aexists_by_name( this->mFileId, "/", attributeName.c_str(), H5P_DEFAULT ) <= 0 ) {
+		return -1;
+	}
+
+	// read the reference to the indexed dataset and try to open it
+	hid_t attribute = H5Aopen_by_name( this->mFileId, "/", attributeName.c_str(), H5P_DEFAULT, H5P_DEFAULT );
+	if( attribute < 0 ) {
+		return -1;
+	}
+	herr_t status = H5Aread( attribute, H5T_STD_REF_OBJ, &reference );
+	H5Aclose( attribute );
+	if( status < 0 ) {
+		return -1;
+	}
+	hid_t dataset = H5Rdereference2( this->mFileId, H5P_DEFAULT, H5R_OBJECT, &reference );
+	if( dataset < 0 ) {
+		return -1;
+	}
+
+	// the reference may point to another object if the indexed dataset was removed, so be
+	// sure that it is a dataset with the same shape and element size before reading it
+	if( H5Iget_type( dataset ) != H5I_DATASET ) {
+		H5Oclose( dataset );
+		return -1;
+	}
+	hsize_t storedDims[ 2 ];
+	hid_t storedSpace = H5Dget_space( dataset );
+	hid_t storedType = H5Dget_type( dataset );
+	const bool sameLayout = H5Sget_simple_extent_ndims( storedSpace ) == 2 && H5Sget_simple_extent_dims( storedSpace, storedDims, NULL ) == 2 && storedDims[ 0 ] == dims[ 0 ] && storedDims[ 1 ] == dims[ 1 ] && H5Tget_size( storedType ) == H5Tget_size( nativeType );
+	H5Tclose( storedType );
+	H5Sclose( storedSpace );
+	if( !sameLayout ) {
+		H5Dclose( dataset );
+		return -1;
+	}
+
+	// read the stored data to be sure that it was not a hash collision
+	boost::timer::cpu_timer verificationTimer;
+	const size_t numberOfBytes = matrix.total() * matrix.elemSize();
+	std::vector< unsigned char > storedData( numberOfBytes );
+	status = H5Dread( dataset, nativeType, H5S_ALL, H5S_ALL, H5P_DEFAULT, storedData.data() );
+	const bool identical = status >= 0 && memcmp( storedData.data(), matrix.ptr(), numberOfBytes ) == 0;
+	verificationTimer.stop();
+
+	// update the statistics
+	this->mDeduplicationStatistics.bytesVerified += numberOfBytes;
+	this->mDeduplicationStatistics.verificationTime += verificationTimer.elapsed().wall;
+
+	//
+	if( !identical ) {
+		H5Dclose( dataset );
+		return -1;
+	}
+
+	return dataset;
+}
+
+void HDF5::addToDeduplicationIndex( const hid_t & dataset, const std::string & key ) noexcept {
+	const std::string attributeName = DEDUPLICATION_INDEX_PREFIX + key;
+	hobj_ref_t reference;
+
+	// an existing entry could not be used (e.g. a hash collision), so it is replaced
+	if( H5Aexists_by_name( this->mFileId, "/", attributeName.c_str(), H5P_DEFAULT ) > 0 ) {
+		H5Adelete_by_name( this->mFileId, "/", attributeName.c_str(), H5P_DEFAULT );
+	}
+
+	// store a reference to the dataset as an attribute of the root group
+	if( H5Rcreate( &reference, dataset, ".", H5R_OBJECT, -1 ) < 0 ) {
+		return;
+	}
+	hid_t dataspace = H5Screate( H5S_SCALAR );
+	hid_t attribute = H5Acreate_by_name( this->mFileId, "/", attributeName.c_str(), H5T_STD_REF_OBJ, dataspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+	if( attribute >= 0 ) {
+		H5Awrite( attribute, H5T_STD_REF_OBJ, &reference );
+		H5Aclose( attribute );
+	}
+	H5Sclose( dataspace );
+}
+
 void HDF5::addMatrix( const cv::Mat & matrix, const std::string & pathInsideHDF5, const std::string & fileNameInContainer ) noexcept {
+	this->storeMatrix( matrix, pathInsideHDF5, fileNameInContainer, 0, 1 );
+}
+
+void HDF5::addMatrixCompressed( const cv::Mat & matrix, const std::string & pathInsideHDF5, const std::string & fileNameInContainer, const int & compressionLevel, const unsigned int & numberOfThreads ) noexcept {
+	this->storeMatrix( matrix, pathInsideHDF5, fileNameInContainer, std::min( std::max( compressionLevel, 1 ), 9 ), numberOfThreads );
+}
+
+void HDF5::storeMatrix( const cv::Mat & inputMatrix, const std::string & pathInsideHDF5, const std::string & fileNameInContainer, const int & compressionLevel, const unsigned int & numberOfThreads ) noexcept {
 	hsize_t dims[ 2 ];
 	hid_t dataspace_id, adataspace_id, dataset_id, attribute_id;
 	herr_t status;
 	hsize_t adims = 1;
 	bool threeChan = false;
+	std::string deduplicationKey;
 
-	// check if the group already exists, of not create it
-	if( !this->groupExists( pathInsideHDF5 ) ) {
-		this->createGroup( pathInsideHDF5 );
-	}
+	// the data has to be stored in one continuous memory block
+	const cv::Mat matrix = inputMatrix.isContinuous() ? inputMatrix : inputMatrix.clone();
+	const size_t numberOfBytes = matrix.total() * matrix.elemSize();
 
 	// check which native type should be used
-	int nativeType = H5T_STD_REF_OBJ;
+	hid_t nativeType = H5T_STD_REF_OBJ;
 	switch( matrix.type() ) {
 		case CV_8U:
 			nativeType = H5T_STD_U8LE;
@@ -163,6 +569,12 @@ void HDF5::addMatrix( const cv::Mat & matrix, const std::string & pathInsideHDF5
 			break;
 		default:
 			std::cerr << "ERROR: Image type is unkown: " << matrix.type() << std::endl; // TODO: better error handling
+			return;
+	}
+
+	// check if the group already exists, of not create it
+	if( !this->groupExists( pathInsideHDF5 ) ) {
+		this->createGroup( pathInsideHDF5 );
 	}
 
 	// create the data space for the dataset
@@ -173,11 +585,41 @@ void HDF5::addMatrix( const cv::Mat & matrix, const std::string & pathInsideHDF5
 	// open the requested group
 	hid_t groupId = H5Gopen( this->mFileId, pathInsideHDF5.c_str(), H5P_DEFAULT );
 
-	// create the dataset
-	dataset_id = H5Dcreate2( groupId, fileNameInContainer.c_str(), nativeType, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+	// if the same data was already stored, just link to the existing dataset
+	if( this->mDeduplicationEnabled ) {
+		deduplicationKey = this->getDeduplicationKey( matrix, compressionLevel );
+		hid_t duplicate = this->findDuplicate( matrix, nativeType, dims, deduplicationKey );
+		if( duplicate >= 0 ) {
+			status = H5Lcreate_hard( duplicate, ".", groupId, fileNameInContainer.c_str(), H5P_DEFAULT, H5P_DEFAULT );
+			H5Dclose( duplicate );
+			if( status >= 0 ) {
+				this->mDeduplicationStatistics.matricesLinked++;
+				this->mDeduplicationStatistics.bytesSaved += numberOfBytes;
+				H5Sclose( dataspace_id );
+				H5Gclose( groupId );
+				return;
+			}
+		}
+	}
 
-	//
-	status = H5Dwrite( dataset_id, nativeType, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT, matrix.ptr() );
+	// create the dataset and write the data (compressed, if requested)
+	herr_t writeStatus = 0;
+	if( compressionLevel > 0 ) {
+		dataset_id = createCompressedDataset( groupId, fileNameInContainer, matrix.ptr(), numberOfBytes, nativeType, dataspace_id, dims, compressionLevel, numberOfThreads );
+	} else {
+		dataset_id = H5Dcreate2( groupId, fileNameInContainer.c_str(), nativeType, dataspace_id, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+		if( dataset_id >= 0 ) {
+			writeStatus = H5Dwrite( dataset_id, nativeType, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT, matrix.ptr() );
+		}
+	}
+
+	// if the dataset could not be created (e.g. the name is already used), there is nothing left to do
+	if( dataset_id < 0 ) {
+		std::cerr << "ERROR: Could not create the dataset " << fileNameInContainer << " in " << pathInsideHDF5 << std::endl; // TODO: better error handling
+		H5Sclose( dataspace_id );
+		H5Gclose( groupId );
+		return;
+	}
 
 	// determine the value for the attribute which indicates if it is a color image or not
 	const int32_t matrixType = matrix.type();
@@ -197,6 +639,13 @@ void HDF5::addMatrix( const cv::Mat & matrix, const std::string & pathInsideHDF5
 	// close the data space used for the attribute
 	status = H5Sclose( adataspace_id );
 
+	// register the new dataset in the deduplication index (just if the data was written correctly)
+	if( this->mDeduplicationEnabled && writeStatus >= 0 ) {
+		this->addToDeduplicationIndex( dataset_id, deduplicationKey );
+		this->mDeduplicationStatistics.matricesWritten++;
+		this->mDeduplicationStatistics.bytesWritten += numberOfBytes;
+	}
+
 	// end access to the dataset and release resources used by it.
 	status = H5Dclose( dataset_id );
 
@@ -22,7 +22,9 @@
 #include <timmilicious/timmilicious.hxx>
 #include <opencv2/opencv.hpp>
 #include <boost/any.hpp>
+#include <boost/timer/timer.hpp>
 #include <hdf5.h>
+#include <cstdint>
 #include <string>
 #include <map>
 
@@ -36,6 +38,37 @@ namespace timmilicious {
 		 */
 		class HDF5 {
 			public:
+				/**
+				 * Statistics which are collected by \ref addMatrix and \ref addMatrixCompressed while the deduplication
+				 * mode is enabled.
+				 */
+				struct DeduplicationStatistics {
+					uint64_t matricesWritten; // << The number of matrices whose data was written to the container.
+					uint64_t matricesLinked; // << The number of matrices which were stored as a hard link to existing data.
+					uint64_t bytesHashed; // << The number of bytes which were hashed.
+					uint64_t bytesWritten; // << The number of (uncompressed) bytes which were written to the container.
+					uint64_t bytesSaved; // << The number of bytes which did not have to be written again.
+					uint64_t bytesVerified; // << The number of bytes which were read back to rule out hash collisions.
+					boost::timer::nanosecond_type hashingTime; // << The wall time (in nanoseconds) spent for hashing.
+					boost::timer::nanosecond_type verificationTime; // << The wall time (in nanoseconds) spent for reading and comparing stored data.
+
+					/**
+					 * Get the time which was required for hashing one megabyte of matrix data.
+					 *
+					 * \return The hashing overhead in milliseconds per megabyte.
+					 */
+					double getHashingOverheadPerMegabyte() const noexcept;
+
+					/**
+					 * Get the time which was required for reading back and comparing one megabyte
+					 * of already stored data. This has to be done for every index hit and is usually
+					 * the dominating cost for long runs of identical matrices.
+					 *
+					 * \return The verification overhead in milliseconds per megabyte.
+					 */
+					double getVerificationOverheadPerMegabyte() const noexcept;
+				};
+
 				/**
 				 * Create a new instance of this class.
 				 *
@@ -75,6 +108,54 @@ namespace timmilicious {
 				 */
 				void addMatrix( const cv::Mat & matrix, const std::string & pathInsideHDF5, const std::string & fileNameInContainer ) noexcept;
 
+				/**
+				 * Adds an OpenCV matrix as a deflate compressed dataset to the HDF5 container.
+				 *
+				 * The matrix is split into chunks of full rows which are compressed by multiple
+				 * threads and written directly into the file (bypassing the single-threaded
+				 * filter pipeline of the HDF5 library). The result is a standard deflate
+				 * filtered dataset which can be read by any HDF5 reader.
+				 *
+				 * \param[in] matrix The matrix to add to the container file.
+				 * \param[in] pathInsideHDF5 The path inside of the container.
+				 * \param[in] fileNameInContainer The name of the matrix inside of the container file.
+				 * \param[in] compressionLevel The deflate compression level (1 - 9).
+				 * \param[in] numberOfThreads The number of threads used for compressing, 0 to use one per CPU core.
+				 */
+				void addMatrixCompressed( const cv::Mat & matrix, const std::string & pathInsideHDF5, const std::string & fileNameInContainer, const int & compressionLevel = 6, const unsigned int & numberOfThreads = 0 ) noexcept;
+
+				/**
+				 * Enable or disable the content-addressed deduplication of matrices.
+				 *
+				 * If enabled, \ref addMatrix and \ref addMatrixCompressed hash the data, type and shape of each matrix and
+				 * look the hash up in an index which is stored inside of the container. If the
+				 * same data was already stored, a hard link to the existing dataset is created
+				 * instead of writing the data again. Readers do not have to know about this.
+				 * Matrices are just linked to datasets which were stored with the same
+				 * compression level, so the requested storage is always honored.
+				 *
+				 * The index is stored as object references in attributes of the root group
+				 * (named "__timmilicious_dedup_<key>"), so it does not show up as additional
+				 * groups or datasets when walking through the container.
+				 *
+				 * \param[in] enable True if the deduplication should be used, false if not.
+				 */
+				void setDeduplication( const bool & enable ) noexcept;
+
+				/**
+				 * Check if the content-addressed deduplication of matrices is enabled.
+				 *
+				 * \return True if the deduplication is enabled, false if not.
+				 */
+				bool isDeduplicationEnabled() const noexcept;
+
+				/**
+				 * Get the statistics which were collected since the container was opened.
+				 *
+				 * \return The statistics about the deduplication.
+				 */
+				const DeduplicationStatistics & getDeduplicationStatistics() const noexcept;
+
 				/**
 				 * Get the attributes for a file inside of the HDF5 container.
 				 *
@@ -84,9 +165,51 @@ namespace timmilicious {
 				std::map< std::string, boost::any > getAttributes( const std::string & filenameInsideHDF5 ) noexcept;
 
 			private:
+				/**
+				 * Store an OpenCV matrix inside of the HDF5 container.
+				 *
+				 * \param[in] matrix The matrix to add to the container file.
+				 * \param[in] pathInsideHDF5 The path inside of the container.
+				 * \param[in] fileNameInContainer The name of the matrix inside of the container file.
+				 * \param[in] compressionLevel The deflate compression level, 0 to store the data uncompressed.
+				 * \param[in] numberOfThreads The number of threads used for compressing, 0 to use one per CPU core.
+				 */
+				void storeMatrix( const cv::Mat & matrix, const std::string & pathInsideHDF5, const std::string & fileNameInContainer, const int & compressionLevel, const unsigned int & numberOfThreads ) noexcept;
+
+				/**
+				 * Get the name of the entry inside of the deduplication index for a matrix.
+				 *
+				 * \param[in] matrix The (continuous) matrix to hash.
+				 * \param[in] compressionLevel The deflate compression level used for storing the matrix.
+				 * \return The name of the index entry for the supplied matrix.
+				 */
+				std::string getDeduplicationKey( const cv::Mat & matrix, const int & compressionLevel ) noexcept;
+
+				/**
+				 * Search the deduplication index for a dataset with the same content as the
+				 * supplied matrix.
+				 *
+				 * \param[in] matrix The (continuous) matrix to look for.
+				 * \param[in] nativeType The HDF5 type used for storing the matrix data.
+				 * \param[in] dims The dimensions of the dataset used for storing the matrix data.
+				 * \param[in] key The name of the index entry for the matrix.
+				 * \return The opened dataset with the same content or a negative value if no such dataset was found.
+				 */
+				hid_t findDuplicate( const cv::Mat & matrix, const hid_t & nativeType, const hsize_t *dims, const std::string & key ) noexcept;
+
+				/**
+				 * Add a dataset to the deduplication index (or replace the existing entry).
+				 *
+				 * \param[in] dataset The dataset which should be added to the index.
+				 * \param[in] key The name of the index entry for the dataset.
+				 */
+				void addToDeduplicationIndex( const hid_t & dataset, const std::string & key ) noexcept;
+
 				hid_t mFileId; // << The internal handle to the opened HDF5 file.
+				DeduplicationStatistics mDeduplicationStatistics; // << The statistics collected while deduplicating matrices.
+				bool mDeduplicationEnabled; // << Should identical matrices be stored as hard links?
 
-				ALIGN_CLASS( 4 );
+				ALIGN_CLASS( 7 );
 
 		}; /* class HDF5 */
 